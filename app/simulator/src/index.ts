@@ -4,15 +4,24 @@ import yargs from "yargs";
 import { hideBin } from "yargs/helpers";
 import { initSerial } from "./modes/serial.ts";
 import { initServer } from "./modes/web.ts";
+import { runBenchmark, runDnsBenchmark } from "./modes/bench.ts";
 
 const argv = await yargs(hideBin(process.argv))
   .options({
     port: { type: "string", default: "/dev/cu.usbmodem1101" },
     mode: { type: "string", default: "web" },
+    stats: { type: "boolean", default: false },
+    transport: { type: "string", default: "serial" },
+    url: { type: "string", default: "ws://192.168.4.1/" },
+    iterations: { type: "number", default: 100 },
+    command: { type: "string", default: "memory" },
+    host: { type: "string", default: "192.168.4.1" },
+    burst: { type: "number", default: 20 },
   })
   .parse();
 
-const simMode: "web" | "serial" = argv.mode === "web" ? "web" : "serial";
+const simMode: "web" | "serial" | "bench" =
+  argv.mode === "web" || argv.mode === "bench" ? argv.mode : "serial";
 
 async function main() {
   const logger = pino({
@@ -23,7 +32,18 @@ async function main() {
   });
 
   if (simMode === "serial") {
-    initSerial(argv.port, logger);
+    initSerial(argv.port, logger, argv.stats);
+  } else if (simMode === "bench" && argv.transport === "dns") {
+    await runDnsBenchmark(argv.host, argv.iterations, argv.burst, logger);
+  } else if (simMode === "bench") {
+    const target = argv.transport === "ws" ? argv.url : argv.port;
+    await runBenchmark(
+      argv.transport,
+      target,
+      argv.command,
+      argv.iterations,
+      logger
+    );
   } else {
     await initServer(logger);
   }
@@ -0,0 +1,261 @@
+import type { Logger } from "pino";
+
+import { createSocket } from "dgram";
+import { SerialPort } from "serialport";
+import { WebSocket } from "ws";
+import { CommandType } from "./serial.ts";
+import { PUSH_FRAME_PREFIX, type StatsSnapshot } from "../stats.ts";
+
+type Command = { type: CommandType; data?: unknown };
+
+// Round trips a cheap command over a transport to measure dispatch latency
+type Transport = {
+  send(command: Command): void;
+  onResponse(listener: (command: Command) => void): void;
+  close(): void;
+};
+
+function parseFrame(frame: string): Command | undefined {
+  const trimmed = frame.trim();
+  // Pushes and the WebSocket status broadcast are not command responses
+  if (trimmed.startsWith(PUSH_FRAME_PREFIX)) {
+    return undefined;
+  }
+  try {
+    const command = JSON.parse(trimmed);
+    return typeof command === "object" && command?.type !== undefined
+      ? command
+      : undefined;
+  } catch {
+    return undefined;
+  }
+}
+
+async function openSerial(portName: string): Promise<Transport> {
+  const port = new SerialPort({ path: portName, baudRate: 115200 });
+  await new Promise((resolve) => port.on("open", resolve));
+  let pending = "";
+  let listener: (command: Command) => void = () => {};
+  port.on("data", (data: Buffer) => {
+    pending += data.toString("utf-8");
+    let endPosition = pending.indexOf("\n");
+    while (endPosition !== -1) {
+      const command = parseFrame(pending.slice(0, endPosition));
+      pending = pending.slice(endPosition + 1);
+      if (command) {
+        listener(command);
+      }
+      endPosition = pending.indexOf("\n");
+    }
+  });
+  return {
+    send: (command) => port.write(Buffer.from(JSON.stringify(command))),
+    onResponse: (newListener) => (listener = newListener),
+    close: () => port.close(),
+  };
+}
+
+async function openWebSocket(url: string): Promise<Transport> {
+  const socket = new WebSocket(url);
+  await new Promise((resolve) => socket.on("open", resolve));
+  let listener: (command: Command) => void = () => {};
+  socket.on("message", (data) => {
+    const command = parseFrame(data.toString());
+    if (command) {
+      listener(command);
+    }
+  });
+  return {
+    send: (command) => socket.send(JSON.stringify(command)),
+    onResponse: (newListener) => (listener = newListener),
+    close: () => socket.close(),
+  };
+}
+
+const BENCHMARK_COMMANDS: Record<
+  string,
+  { request: Command; responseType: CommandType }
+> = {
+  memory: {
+    request: { type: CommandType.GET_MEMORY_STATS_REQUEST },
+    responseType: CommandType.GET_MEMORY_STATS_RESPONSE,
+  },
+  account: {
+    request: { type: CommandType.GET_ACCOUNT_REQUEST, data: { index: 0 } },
+    responseType: CommandType.GET_ACCOUNT_RESPONSE,
+  },
+  // Serves the key as stored, so it measures the compressed wire format and not
+  // decompression. Decompression only runs once per key per boot, its cost is
+  // read from the device's key stats after the account benchmarks
+  "account-compressed": {
+    request: {
+      type: CommandType.GET_ACCOUNT_REQUEST,
+      data: { index: 0, compressed: true },
+    },
+    responseType: CommandType.GET_ACCOUNT_RESPONSE,
+  },
+};
+
+// Dropped frames get no reply on some paths, so a round trip can't wait forever
+const ROUND_TRIP_TIMEOUT_MS = 5000;
+
+function roundTrip(
+  transport: Transport,
+  request: Command,
+  responseType: CommandType
+): Promise<unknown> {
+  return new Promise((resolve, reject) => {
+    const timeout = setTimeout(
+      () => reject(new Error(`No response after ${ROUND_TRIP_TIMEOUT_MS}ms`)),
+      ROUND_TRIP_TIMEOUT_MS
+    );
+    transport.onResponse((command) => {
+      if (command.type === responseType) {
+        clearTimeout(timeout);
+        resolve(command.data);
+      } else if (command.type === CommandType.ERROR) {
+        clearTimeout(timeout);
+        reject(new Error(JSON.stringify(command.data)));
+      }
+    });
+    transport.send(request);
+  });
+}
+
+// Sorts the latencies in place and formats min, mean, p50, p95 and max in ms
+function summarizeLatencies(latencies: number[]): string {
+  latencies.sort((a, b) => a - b);
+  const percentile = (p: number) =>
+    latencies[Math.min(latencies.length - 1, Math.floor(latencies.length * p))];
+  const mean = latencies.reduce((acc, value) => acc + value, 0) / latencies.length;
+  return [
+    `min ${latencies[0].toFixed(2)}ms`,
+    `mean ${mean.toFixed(2)}ms`,
+    `p50 ${percentile(0.5).toFixed(2)}ms`,
+    `p95 ${percentile(0.95).toFixed(2)}ms`,
+    `max ${latencies[latencies.length - 1].toFixed(2)}ms`,
+  ].join(" | ");
+}
+
+export async function runBenchmark(
+  transportName: string,
+  target: string,
+  commandName: string,
+  iterations: number,
+  logger: Logger
+) {
+  if (!BENCHMARK_COMMANDS[commandName]) {
+    logger.error("Unknown benchmark command %s", commandName);
+    return;
+  }
+  const transport =
+    transportName === "ws"
+      ? await openWebSocket(target)
+      : await openSerial(target);
+
+  const { request, responseType } = BENCHMARK_COMMANDS[commandName];
+  const latencies: number[] = [];
+  try {
+    for (let i = 0; i < iterations; i++) {
+      const start = process.hrtime.bigint();
+      await roundTrip(transport, request, responseType);
+      latencies.push(Number(process.hrtime.bigint() - start) / 1e6);
+    }
+    if (commandName.startsWith("account")) {
+      const stats = (await roundTrip(
+        transport,
+        { type: CommandType.GET_STATS_REQUEST },
+        CommandType.GET_STATS_RESPONSE
+      )) as StatsSnapshot;
+      logger.info(
+        "Key decompressions since boot: %d | last %dus | max %dus",
+        stats.keys.decompressions,
+        stats.keys.last,
+        stats.keys.max
+      );
+    }
+  } catch (err) {
+    logger.error(
+      "%s %s failed after %d iterations: %s",
+      transportName,
+      commandName,
+      latencies.length,
+      (err as Error).message
+    );
+    return;
+  } finally {
+    transport.close();
+  }
+
+  logger.info(
+    "%s %s round trip over %d iterations: %s",
+    transportName,
+    commandName,
+    iterations,
+    summarizeLatencies(latencies)
+  );
+}
+
+function buildDnsQuery(id: number, name: string): Buffer {
+  const header = Buffer.alloc(12);
+  header.writeUInt16BE(id, 0);
+  // Standard query, recursion desired
+  header.writeUInt16BE(0x0100, 2);
+  header.writeUInt16BE(1, 4);
+  const labels = name
+    .split(".")
+    .map((label) => Buffer.concat([Buffer.from([label.length]), Buffer.from(label)]));
+  // Root label, QTYPE A, QCLASS IN
+  const question = Buffer.from([0, 0, 1, 0, 1]);
+  return Buffer.concat([header, ...labels, question]);
+}
+
+// Fires bursts of concurrent A queries, like a phone probing a captive portal
+export async function runDnsBenchmark(
+  host: string,
+  iterations: number,
+  burst: number,
+  logger: Logger
+) {
+  const socket = createSocket("udp4");
+  const pending = new Map<number, bigint>();
+  const latencies: number[] = [];
+  let lost = 0;
+  socket.on("message", (message: Buffer) => {
+    const id = message.readUInt16BE(0);
+    const start = pending.get(id);
+    if (start !== undefined) {
+      latencies.push(Number(process.hrtime.bigint() - start) / 1e6);
+      pending.delete(id);
+    }
+  });
+
+  let id = 0;
+  for (let i = 0; i < iterations; i++) {
+    for (let j = 0; j < burst; j++) {
+      id = (id + 1) & 0xffff;
+      pending.set(id, process.hrtime.bigint());
+      socket.send(buildDnsQuery(id, `probe${j}.example.com`), 53, host);
+    }
+    // Give stragglers a second before counting them as lost
+    const deadline = Date.now() + 1000;
+    while (pending.size > 0 && Date.now() < deadline) {
+      await new Promise((resolve) => setTimeout(resolve, 1));
+    }
+    lost += pending.size;
+    pending.clear();
+  }
+  socket.close();
+
+  if (latencies.length === 0) {
+    logger.error("No DNS responses from %s", host);
+    return;
+  }
+  logger.info(
+    "dns %d bursts of %d queries: %s | lost %d",
+    iterations,
+    burst,
+    summarizeLatencies(latencies),
+    lost
+  );
+}
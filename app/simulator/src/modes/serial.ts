@@ -3,6 +3,7 @@ import type { Logger } from "pino";
 import { SerialPort } from "serialport";
 import { inflate } from "pako";
 import { MESSAGE_TO_SIGN } from "../state.ts";
+import { PUSH_FRAME_PREFIX, renderStats } from "../stats.ts";
 
 export enum CommandType {
   SIGNATURE_REQUEST,
@@ -16,6 +17,14 @@ export enum CommandType {
   GET_SENDER_REQUEST,
   GET_SENDER_RESPONSE,
   ERROR,
+  GET_MEMORY_STATS_REQUEST,
+  GET_MEMORY_STATS_RESPONSE,
+  GET_STATS_REQUEST,
+  GET_STATS_RESPONSE,
+  SIGNATURE_STREAM_START,
+  SIGNATURE_STREAM_CHUNK,
+  SIGNATURE_STREAM_END,
+  SIGNATURE_STREAM_ACK,
 }
 
 const signRequest = {
@@ -43,7 +52,18 @@ const artifactRequest = {
   type: CommandType.GET_ARTIFACT_REQUEST,
 };
 
-export function initSerial(portName: string, logger: Logger) {
+const statsSubscribeRequest = {
+  type: CommandType.GET_STATS_REQUEST,
+  data: {
+    subscribe: true,
+  },
+};
+
+export function initSerial(
+  portName: string,
+  logger: Logger,
+  subscribeStats = false
+) {
   const currentData: Buffer[] = [Buffer.alloc(0)];
   const port = new SerialPort({ path: portName, baudRate: 115200 });
 
@@ -53,6 +73,9 @@ export function initSerial(portName: string, logger: Logger) {
 
   setTimeout(() => {
     port.write(Buffer.from(JSON.stringify(accountRequest)));
+    if (subscribeStats) {
+      port.write(Buffer.from(JSON.stringify(statsSubscribeRequest)));
+    }
     port.drain();
   }, 2000);
 
@@ -88,16 +111,28 @@ export function initSerial(portName: string, logger: Logger) {
 
     while (accumulatedData.length > 0) {
       if (portMode === "command") {
-        const maybeCommand = accumulatedData.shift()!;
+        let maybeCommand = accumulatedData.shift()!;
+        // Periodic pushes are framed with a prefix so they can be told apart from responses
+        const isPush =
+          maybeCommand.toString("utf-8", 0, 1) === PUSH_FRAME_PREFIX;
+        if (isPush) {
+          maybeCommand = maybeCommand.subarray(1);
+        }
         try {
           const command = JSON.parse(maybeCommand.toString("utf-8").trim());
           if (!command.type) {
             throw new Error("Invalid command");
           }
 
-          logger.info("Parsed command %o", command);
+          if (!isPush) {
+            logger.info("Parsed command %o", command);
+          }
 
           switch (parseInt(command.type)) {
+            case CommandType.GET_STATS_RESPONSE: {
+              logger.info("\n%s", renderStats(command.data));
+              break;
+            }
             case CommandType.GET_ARTIFACT_RESPONSE_START: {
               currentDataTransfer = Buffer.alloc(0);
               currentDataBytesLeft = command.data.size;
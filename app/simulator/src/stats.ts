@@ -0,0 +1,126 @@
+export const PUSH_FRAME_PREFIX = "#";
+
+export const ERROR_REASONS = [
+  "Unknown error",
+  "JSON parse",
+  "Invalid public key",
+  "Failed verification",
+  "Invalid sender request",
+  "Invalid signature stream",
+];
+
+export type TaskStats = {
+  // Names and boot info are only in GET_STATS_REQUEST responses, pushes omit them
+  name?: string;
+  active: boolean;
+  successes: number;
+  failures: number;
+  frequency: number;
+  min: number;
+  mean: number;
+  max: number;
+  ratio: number;
+};
+
+export type MemoryStats = {
+  heap: {
+    free: number;
+    largestFreeBlock: number;
+    fragmentation: number;
+    minFree: number;
+    minLargestFreeBlock: number;
+    maxFragmentation: number;
+  };
+  stacks: { task?: string; highWaterMark: number; minHighWaterMark: number }[];
+};
+
+export type BootStats = {
+  phases: { name: string; end: number }[];
+  firstCommand: number;
+  failed?: string;
+};
+
+export type StatsSnapshot = {
+  loopFrequency: number;
+  tasks: TaskStats[];
+  errors: number[];
+  errorsPerSecond: number[];
+  dns: { queries: number; rate: number; mean: number; max: number };
+  keys: { decompressions: number; last: number; max: number };
+  boot?: BootStats;
+  memory: MemoryStats;
+};
+
+// Static metadata from the last full response, reused to label pushes
+const metadata: { taskNames: string[]; stackNames: string[]; boot?: BootStats } =
+  { taskNames: [], stackNames: [] };
+
+function rememberMetadata(snapshot: StatsSnapshot) {
+  if (snapshot.boot) {
+    metadata.taskNames = snapshot.tasks.map((task) => task.name ?? "");
+    metadata.stackNames = snapshot.memory.stacks.map((stack) => stack.task ?? "");
+    metadata.boot = snapshot.boot;
+  }
+}
+
+export function renderStats(snapshot: StatsSnapshot): string {
+  rememberMetadata(snapshot);
+  const lines: string[] = [];
+  const separator = "-".repeat(77);
+  lines.push(
+    `${"Task".padEnd(23)} | ${"Freq".padStart(8)} | ${"Min".padStart(8)} | ${"Mean".padStart(11)} | ${"Max".padStart(8)} | Ratio`
+  );
+  lines.push(separator);
+  snapshot.tasks.forEach((task, id) => {
+    if (!task.active) {
+      return;
+    }
+    const name = task.name ?? metadata.taskNames[id] ?? `task ${id}`;
+    lines.push(
+      `${name.padEnd(23)} | ${task.frequency.toFixed(2).padStart(6)}Hz | ${String(task.min).padStart(6)}us | ~${task.mean.toFixed(2).padStart(8)}us | ${String(task.max).padStart(6)}us | ${task.ratio.toFixed(2)}`
+    );
+  });
+  lines.push(separator);
+  lines.push(`Loop frequency: ${snapshot.loopFrequency.toFixed(2)}Hz`);
+  lines.push("");
+  lines.push(`${"Error code".padEnd(23)} | ${"Count/s".padStart(8)}`);
+  lines.push("-".repeat(37));
+  snapshot.errorsPerSecond.forEach((rate, code) => {
+    lines.push(
+      `${(ERROR_REASONS[code] ?? ERROR_REASONS[0]).padEnd(23)} | ${rate.toFixed(2).padStart(5)}`
+    );
+  });
+  lines.push("-".repeat(37));
+  lines.push("");
+  const { dns } = snapshot;
+  lines.push(
+    `DNS: ${dns.rate.toFixed(2)} queries/s | ~${dns.mean.toFixed(2)}us mean | ${dns.max}us max`
+  );
+  lines.push("");
+  const { keys } = snapshot;
+  lines.push(
+    `Key decompressions: ${keys.decompressions} | ${keys.last}us last | ${keys.max}us max`
+  );
+  lines.push("");
+  const { boot } = metadata;
+  if (boot) {
+    lines.push(
+      `Boot: ${boot.phases
+        .filter((phase) => phase.end > 0)
+        .map((phase) => `${phase.name} ${(phase.end / 1e3).toFixed(1)}ms`)
+        .join(" | ")} | first command ${(boot.firstCommand / 1e3).toFixed(1)}ms${boot.failed ? ` | failed at ${boot.failed}` : ""}`
+    );
+    lines.push("");
+  }
+  const { heap, stacks } = snapshot.memory;
+  lines.push(
+    `Heap free: ${heap.free}B, largest block: ${heap.largestFreeBlock}B, fragmentation: ${heap.fragmentation.toFixed(2)}%, min free: ${heap.minFree}B`
+  );
+  stacks.forEach((stack, id) => {
+    const task = stack.task ?? metadata.stackNames[id] ?? `task ${id}`;
+    lines.push(
+      `${task.padEnd(23)} | ${String(stack.highWaterMark).padStart(6)}B stack free | ${String(stack.minHighWaterMark).padStart(6)}B min`
+    );
+  });
+  return lines.join("\n");
+}
@@ -11,7 +11,14 @@ const int RNG_SOURCE = 1;
 
 // Scheduler
 
-const int N_TASKS = 3;
+// Task ids, in dispatch order. Each task is defined in TASKS (tasks.h)
+enum TaskId {
+    READ_COMMANDS,
+    DO_SERVER_WORK,
+    COLLECT_STATS,
+    N_TASKS
+};
+
 struct TaskResult {
     bool success;
     long offset;
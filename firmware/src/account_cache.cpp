@@ -0,0 +1,74 @@
+#include "account_cache.h"
+#include "commands.h"
+
+String accountResponses[MAX_ACCOUNTS][ACCOUNT_RESPONSE_FORMATS];
+bool validResponses[MAX_ACCOUNTS][ACCOUNT_RESPONSE_FORMATS];
+
+// Accounts are read from the loop task (serial, WebSocket) and written from async_tcp (portal)
+SemaphoreHandle_t accountCacheLock;
+
+void buildAccountResponse(int index, AccountResponseFormat format) {
+  JsonDocument response;
+  String &output = accountResponses[index][format];
+  output = "";
+  bool compressed = format == COMPRESSED_COMMAND_RESPONSE || format == COMPRESSED_PORTAL_RESPONSE;
+  if(format == COMMAND_RESPONSE || format == COMPRESSED_COMMAND_RESPONSE) {
+    response[F("type")] = GET_ACCOUNT_RESPONSE;
+    serializeAccount(index, response[F("data")].to<JsonObject>(), compressed);
+  } else {
+    JsonObject root = response.to<JsonObject>();
+    serializeAccount(index, root, compressed);
+    JsonArray contract_class_id_array = root[F("contractClassId")].to<JsonArray>();
+    uint8_t contractClassId[32];
+    readContractClassId(contractClassId);
+    for(int i = 0; i < 32; i++) {
+      contract_class_id_array[i] = contractClassId[i];
+    }
+  }
+  output.reserve(measureJson(response));
+  serializeJson(response, output);
+  validResponses[index][format] = true;
+}
+
+// Responses are built on first use rather than at boot, to keep EEPROM reads off the boot path
+void setupAccountCache() {
+  accountCacheLock = xSemaphoreCreateMutex();
+}
+
+void cacheAccount(int index) {
+  if(!isValidAccountIndex(index)) {
+    return;
+  }
+  xSemaphoreTake(accountCacheLock, portMAX_DELAY);
+  for(int format = 0; format < ACCOUNT_RESPONSE_FORMATS; format++) {
+    validResponses[index][format] = false;
+  }
+  // Compressed formats are opt-in, so they are left to be built on first use
+  buildAccountResponse(index, COMMAND_RESPONSE);
+  buildAccountResponse(index, PORTAL_RESPONSE);
+  xSemaphoreGive(accountCacheLock);
+}
+
+void invalidateAccount(int index) {
+  if(!isValidAccountIndex(index)) {
+    return;
+  }
+  xSemaphoreTake(accountCacheLock, portMAX_DELAY);
+  for(int format = 0; format < ACCOUNT_RESPONSE_FORMATS; format++) {
+    validResponses[index][format] = false;
+    accountResponses[index][format] = "";
+  }
+  xSemaphoreGive(accountCacheLock);
+}
+
+void withAccountResponse(int index, AccountResponseFormat format, std::function<void(const String &)> send) {
+  if(!isValidAccountIndex(index)) {
+    return;
+  }
+  xSemaphoreTake(accountCacheLock, portMAX_DELAY);
+  if(!validResponses[index][format]) {
+    buildAccountResponse(index, format);
+  }
+  send(accountResponses[index][format]);
+  xSemaphoreGive(accountCacheLock);
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <Arduino.h>
+#include <functional>
+#include "config.h"
+
+enum AccountResponseFormat {
+    // GET_ACCOUNT_RESPONSE command, for serial and WebSocket hosts
+    COMMAND_RESPONSE,
+    COMPRESSED_COMMAND_RESPONSE,
+    // GET /accounts body, which also carries the contract class id
+    PORTAL_RESPONSE,
+    COMPRESSED_PORTAL_RESPONSE,
+    ACCOUNT_RESPONSE_FORMATS
+};
+
+// Serialized account responses, built when an account is written or on first
+// use after boot, so reads don't touch EEPROM or rebuild JSON
+void setupAccountCache();
+void cacheAccount(int index);
+void invalidateAccount(int index);
+
+// Calls send with the cached response while holding the cache lock
+void withAccountResponse(int index, AccountResponseFormat format, std::function<void(const String &)> send);
@@ -0,0 +1,95 @@
+#include "async_dns.h"
+
+const uint16_t DNS_TYPE_A = 1;
+const uint16_t DNS_CLASS_IN = 1;
+
+bool AsyncDNSServer::start(uint16_t port, IPAddress ip) {
+  resolvedIP = ip;
+  if(!udp.listen(port)) {
+    return false;
+  }
+  udp.onPacket([this](AsyncUDPPacket &packet) {
+    handlePacket(packet);
+  });
+  return true;
+}
+
+void AsyncDNSServer::setTTL(uint32_t newTTL) {
+  ttl = newTTL;
+}
+
+void AsyncDNSServer::stop() {
+  udp.close();
+}
+
+void AsyncDNSServer::handlePacket(AsyncUDPPacket &packet) {
+  unsigned long start = micros();
+  size_t length = buildResponse(packet.data(), packet.length());
+  if(length == 0) {
+    return;
+  }
+  packet.write(response, length);
+  recordDnsQuery(micros() - start);
+}
+
+// Returns the response length, or 0 if the packet should be dropped
+size_t AsyncDNSServer::buildResponse(const uint8_t *query, size_t length) {
+  if(length < DNS_HEADER_SIZE || length > DNS_MAX_PACKET_SIZE) {
+    return 0;
+  }
+  bool isResponse = query[2] & 0x80;
+  uint8_t opcode = (query[2] >> 3) & 0x0F;
+  uint16_t questions = (query[4] << 8) | query[5];
+  if(isResponse || opcode != 0 || questions != 1) {
+    return 0;
+  }
+
+  // Walk the question name labels
+  size_t position = DNS_HEADER_SIZE;
+  while(position < length && query[position] != 0) {
+    // Compression pointers are not valid in a question
+    if(query[position] & 0xC0) {
+      return 0;
+    }
+    position += query[position] + 1;
+  }
+  // Terminating zero plus QTYPE and QCLASS
+  size_t questionEnd = position + 1 + 4;
+  if(questionEnd > length) {
+    return 0;
+  }
+  uint16_t type = (query[position + 1] << 8) | query[position + 2];
+  uint16_t queryClass = (query[position + 3] << 8) | query[position + 4];
+
+  memcpy(response, query, questionEnd);
+  // QR + AA, keep RD from the query, RCODE NoError
+  response[2] = 0x84 | (query[2] & 0x01);
+  response[3] = 0x00;
+  // ANCOUNT, NSCOUNT, ARCOUNT. Non-A queries get an empty NoError answer
+  bool answer = type == DNS_TYPE_A && queryClass == DNS_CLASS_IN;
+  response[6] = 0;
+  response[7] = answer ? 1 : 0;
+  memset(response + 8, 0, 4);
+  if(!answer) {
+    return questionEnd;
+  }
+
+  uint8_t *record = response + questionEnd;
+  // Name, as a pointer to the question name
+  record[0] = 0xC0;
+  record[1] = DNS_HEADER_SIZE;
+  record[2] = 0;
+  record[3] = DNS_TYPE_A;
+  record[4] = 0;
+  record[5] = DNS_CLASS_IN;
+  record[6] = (ttl >> 24) & 0xFF;
+  record[7] = (ttl >> 16) & 0xFF;
+  record[8] = (ttl >> 8) & 0xFF;
+  record[9] = ttl & 0xFF;
+  record[10] = 0;
+  record[11] = 4;
+  for(int i = 0; i < 4; i++) {
+    record[12 + i] = resolvedIP[i];
+  }
+  return questionEnd + 16;
+}
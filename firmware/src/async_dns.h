@@ -0,0 +1,29 @@
+#pragma once
+
+#include <Arduino.h>
+#include <AsyncUDP.h>
+#include "stats.h"
+
+const uint16_t DNS_PORT = 53;
+// Classic DNS over UDP caps messages at 512 bytes
+const size_t DNS_MAX_PACKET_SIZE = 512;
+const size_t DNS_HEADER_SIZE = 12;
+
+// Captive portal DNS responder. Every A query is answered with the portal IP
+// from the async_udp receive event, instead of being polled from the loop
+class AsyncDNSServer {
+public:
+  bool start(uint16_t port, IPAddress ip);
+  void setTTL(uint32_t ttl);
+  void stop();
+
+private:
+  void handlePacket(AsyncUDPPacket &packet);
+  size_t buildResponse(const uint8_t *query, size_t length);
+
+  AsyncUDP udp;
+  IPAddress resolvedIP;
+  uint32_t ttl = 60;
+  // Only touched from the async_udp task, one packet at a time
+  uint8_t response[DNS_MAX_PACKET_SIZE + 16];
+};
@@ -1,9 +1,14 @@
 #include "captive_portal.h"
+#include "account_cache.h"
+#include "signature_stream.h"
 
-DNSServer dnsServer;
+AsyncDNSServer dnsServer;
 AsyncWebServer server(80);
 AsyncWebSocket ws("/");
 
+// Commands received over the WebSocket, dispatched from the loop task
+QueueHandle_t webSocketCommands;
+
 static AsyncCallbackJsonWebHandler *senderHandler = new AsyncCallbackJsonWebHandler("/sender");
 void configureSenderHandler() {
   senderHandler->setMethod(HTTP_GET);
@@ -56,52 +61,36 @@ void configureaccountsHandler() {
     uint8_t msk[32];
     uint8_t salt[32];
     if(request->method() == HTTP_POST) {
-      state.status = GENERATING_ACCOUNT;
       int index = json.as<JsonObject>()["index"];
+      if(!isValidAccountIndex(index)) {
+        request->send(400, "text/plain", "Invalid index");
+        return;
+      }
+      state.status = GENERATING_ACCOUNT;
       generateKeyPair(&keyPair);
       writeKeyPair(index, &keyPair);
       RNG(msk, 32);
       RNG(salt, 32);
       writeSecretKey(index, msk);
       writeSalt(index, salt);
+      cacheAccount(index);
       state.status = IDLE;
       request->send(200, "text/plain", "Ok");
     } else if (request->method() == HTTP_PUT) {
       int index = json.as<JsonObject>()["index"];
-      sendAccount(index); 
+      sendAccount(index, state.pendingOrigin, state.pendingCompressed);
       state.status = IDLE;
       request->send(200, "text/plain", "Ok");
     } else {
-      AsyncJsonResponse *response = new AsyncJsonResponse();
-      JsonObject root = response->getRoot().to<JsonObject>();
-      JsonArray pk_array = root[F("pk")].to<JsonArray>();
-      JsonArray msk_array = root[F("msk")].to<JsonArray>();
-      JsonArray salt_array = root[F("salt")].to<JsonArray>();
-      JsonArray contract_class_id_array = root[F("contractClassId")].to<JsonArray>();
-
       int index = request->getParam("index")->value().toInt();
-      root["index"] = index;
-
-      readKeyPair(index, &keyPair);
-      for(int i = 0; i < 64; i++) {
-        pk_array[i] = keyPair.pk[i];
-      }
-      readSecretKey(index, msk);
-      for(int i = 0; i < 32; i++) {
-        msk_array[i] = msk[i];
+      if(!isValidAccountIndex(index)) {
+        request->send(400, "text/plain", "Invalid index");
+        return;
       }
-      readSalt(index, salt);
-      for(int i = 0; i < 32; i++) {
-        salt_array[i] = salt[i];
-      }
-
-      uint8_t contractClassId[32];
-      readContractClassId(contractClassId);
-      for(int i = 0; i < 32; i++) {
-        contract_class_id_array[i] = contractClassId[i];
-      }
-      response->setLength();
-      request->send(response);
+      AccountResponseFormat format = request->hasParam("compressed") ? COMPRESSED_PORTAL_RESPONSE : PORTAL_RESPONSE;
+      withAccountResponse(index, format, [request](const String &output) {
+        request->send(200, "application/json", output);
+      });
     }
   });
 }
@@ -112,23 +101,12 @@ void configureSignatureHandler() {
   signatureHandler->onRequest([](AsyncWebServerRequest *request, JsonVariant &json) {
     if(request->method() == HTTP_POST) {
       bool approve = json.as<JsonObject>()["approve"];
-      sendSignatureResponse(approve);
+      sendSignatureResponse(approve, state.pendingOrigin);
       state.status = IDLE;
       request->send(200, "text/plain", "Ok");
     } else {
-      KeyPair keyPair;
       AsyncJsonResponse *response = new AsyncJsonResponse();
-      JsonObject root = response->getRoot().to<JsonObject>();
-      readKeyPair(state.currentSignatureRequest.index, &keyPair);
-      JsonArray pk = root["pk"].to<JsonArray>();
-      JsonArray msg = root["msg"].to<JsonArray>();
-      for(int i = 0; i < 64; i++) {
-        pk[i] = keyPair.pk[i];
-      }
-      for(int i = 0; i < 64; i++) {
-        msg[i] = state.currentSignatureRequest.msg[i];
-      }
-      root["index"] = state.currentSignatureRequest.index;
+      serializeSignatureRequest(response->getRoot().to<JsonObject>(), request->hasParam("compressed"));
       response->setLength();
       request->send(response);
     }
@@ -152,14 +130,38 @@ public:
 
 void onEvent(AsyncWebSocket *server, AsyncWebSocketClient *client, AwsEventType type,
              void *arg, uint8_t *data, size_t len) {
+  // The async_tcp task handles one event at a time, so a single buffer is enough
+  static WebSocketCommand command;
   switch (type) {
     case WS_EVT_CONNECT:
       Serial.printf("WebSocket client #%u connected from %s\n", client->id(), client->remoteIP().toString().c_str());
       break;
     case WS_EVT_DISCONNECT:
       Serial.printf("WebSocket client #%u disconnected\n", client->id());
+      command.clientId = client->id();
+      command.len = 0;
+      // Waits for the loop task to drain the queue rather than leave a dead subscription behind
+      xQueueSend(webSocketCommands, &command, pdMS_TO_TICKS(1000));
       break;
-    case WS_EVT_DATA:
+    case WS_EVT_DATA: {
+      AwsFrameInfo *info = (AwsFrameInfo *)arg;
+      CommandOrigin origin = { WEBSOCKET_TRANSPORT, client->id() };
+      // Only whole, single frame text messages are accepted as commands
+      if(!info->final || info->index != 0 || info->len != len || info->opcode != WS_TEXT || len == 0 || len >= WS_MAX_COMMAND_SIZE) {
+        // Fragmented messages raise an event per piece, answered once on the last one
+        if(info->final && info->index + len == info->len) {
+          replyError(origin, JSON_PARSE, "Unsupported frame");
+        }
+        break;
+      }
+      command.clientId = client->id();
+      command.len = len;
+      memcpy(command.payload, data, len);
+      if(xQueueSend(webSocketCommands, &command, 0) != pdTRUE) {
+        replyError(origin, UNKNOWN, "Command queue full");
+      }
+      break;
+    }
     case WS_EVT_PONG:
     case WS_EVT_ERROR:
       break;
@@ -167,15 +169,15 @@ void onEvent(AsyncWebSocket *server, AsyncWebSocketClient *client, AwsEventType
 }
 
 void setupServer(){
-  dnsServer.setErrorReplyCode(DNSReplyCode::NoError);
   dnsServer.setTTL(300);
-  dnsServer.start(53, "*", WiFi.softAPIP());
+  dnsServer.start(DNS_PORT, WiFi.softAPIP());
 
   configureaccountsHandler();
   configureSignatureHandler();
   configureSettingsHandler();
   configureSenderHandler();
 
+  webSocketCommands = xQueueCreate(WS_COMMAND_QUEUE_LENGTH, sizeof(WebSocketCommand));
   ws.onEvent(onEvent);
   server.addHandler(&ws);
   server.addHandler(new CaptivePortalHandler()).setFilter(ON_AP_FILTER);
@@ -183,6 +185,13 @@ void setupServer(){
   server.addHandler(signatureHandler);
   server.addHandler(settingsHandler);
   server.addHandler(senderHandler);
+  server.on("/stats/memory", HTTP_GET, [](AsyncWebServerRequest *request){
+    AsyncJsonResponse *response = new AsyncJsonResponse();
+    sampleMemory();
+    serializeMemoryStats(response->getRoot().to<JsonObject>());
+    response->setLength();
+    request->send(response);
+  });
   server.on("/EcdsaRAccount.json.gz", HTTP_GET, [](AsyncWebServerRequest *request){
     request->send(SPIFFS, "/EcdsaRAccount.json.gz", "application/gzip", false);
   });
@@ -193,8 +202,68 @@ void setupServer(){
   server.begin();
 }
 
+// Mounts the filesystem, starts the soft-AP and the server off the loop task,
+// so serial commands are served while the slow steps run
+void startPortalTask(void *parameters) {
+  // No Serial output from here, it would interleave with replies written by the loop task
+  if(!mountFilesystem()) {
+    markBootFailure(BOOT_FILESYSTEM);
+    vTaskDelete(NULL);
+    return;
+  }
+  markBootPhase(BOOT_FILESYSTEM);
+
+  char SSID[32];
+  readSSID(SSID);
+
+  char password[32];
+
+  if(!readPassword(password)) {
+    WiFi.softAP(String(SSID).c_str());
+  } else {
+    WiFi.softAP(String(SSID).c_str(), String(password).c_str());
+  }
+  markBootPhase(BOOT_WIFI);
+
+  setupServer();
+  markBootPhase(BOOT_SERVER);
+  state.activeTasks[DO_SERVER_WORK] = true;
+  vTaskDelete(NULL);
+}
+
+void startPortal() {
+  xTaskCreate(startPortalTask, "startPortal", PORTAL_TASK_STACK_SIZE, NULL, 1, NULL);
+}
+
+void sendWebSocketText(uint32_t clientId, const String &message) {
+  ws.text(clientId, message);
+}
+
+// Stops pushing stats to a client that is gone and drops the signature stream it owned
+void releaseWebSocketClient(uint32_t clientId) {
+  CommandOrigin origin = { WEBSOCKET_TRANSPORT, clientId };
+  if(state.statsSubscribed && sameOrigin(state.statsOrigin, origin)) {
+    state.statsSubscribed = false;
+  }
+  if(ownsSignatureStream(origin)) {
+    abortSignatureStream();
+  }
+}
+
 TaskResult doServerWork(unsigned long now) {
-  dnsServer.processNextRequest();
+  static WebSocketCommand command;
+  while(xQueueReceive(webSocketCommands, &command, 0) == pdTRUE) {
+    if(command.len == 0) {
+      releaseWebSocketClient(command.clientId);
+      continue;
+    }
+    JsonDocument doc;
+    if(deserializeJson(doc, command.payload, command.len)) {
+      setError(JSON_PARSE);
+      continue;
+    }
+    dispatchCommand(doc, { WEBSOCKET_TRANSPORT, command.clientId });
+  }
   ws.textAll(
     state.status + String("")
   );
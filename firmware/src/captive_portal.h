@@ -5,14 +5,29 @@
 #include <ArduinoJson.h>
 #include <AsyncJson.h>
 #include "ESPAsyncWebServer.h"
-#include <DNSServer.h>
+#include "async_dns.h"
 #include "SPIFFS.h"
 #include "curve.h"
 #include "config.h"
 #include "state.h"
 #include "scheduler.h"
-#include "serial_commands.h"
+#include "commands.h"
+
+// Largest WebSocket command accepted, a SIGNATURE_REQUEST is ~700 bytes
+const size_t WS_MAX_COMMAND_SIZE = 1024;
+const int WS_COMMAND_QUEUE_LENGTH = 4;
+
+struct WebSocketCommand {
+    uint32_t clientId;
+    // 0 marks a disconnect, so the loop task can release what the client held
+    size_t len;
+    char payload[WS_MAX_COMMAND_SIZE];
+};
+
+const uint32_t PORTAL_TASK_STACK_SIZE = 8192;
 
 void setupServer();
+void startPortal();
+void sendWebSocketText(uint32_t clientId, const String &message);
 
 TaskResult doServerWork(unsigned long now);
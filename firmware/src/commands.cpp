@@ -0,0 +1,332 @@
+#include "commands.h"
+#include "captive_portal.h"
+#include "account_cache.h"
+#include "signature_stream.h"
+#include "utils.h"
+
+void replyError(CommandOrigin origin, ErrorCode code, const char *message) {
+  JsonDocument response;
+  setError(code);
+  response[F("type")] = ERROR;
+  response[F("data")][F("error")] = message;
+  reply(origin, response);
+}
+
+// Checks the host knows the public key of an initialized account, either compressed or expanded
+bool checkAccountKey(int index, JsonArray pk_array, CommandOrigin origin) {
+  if(!isValidAccountIndex(index)) {
+    replyError(origin, INVALID_PK, "Invalid account index");
+    return false;
+  }
+  uint8_t pk[PUBLIC_KEY_SIZE];
+  int size = PUBLIC_KEY_SIZE;
+  if(pk_array.size() == COMPRESSED_PUBLIC_KEY_SIZE) {
+    // Compared as stored, without decompressing
+    size = COMPRESSED_PUBLIC_KEY_SIZE;
+    readCompressedPublicKey(index, pk);
+  } else {
+    KeyPair keyPair;
+    readKeyPair(index, &keyPair);
+    memcpy(pk, keyPair.pk, PUBLIC_KEY_SIZE);
+  }
+  bool empty = true;
+  for(int i = 0; i < size; i++) {
+    empty &= (pk_array[i] == 255);
+    if(pk_array[i] != pk[i]) {
+      replyError(origin, INVALID_PK, "Invalid public key");
+      return false;
+    }
+  }
+  if (empty) {
+    replyError(origin, INVALID_PK, "Account not initialized");
+    return false;
+  }
+  return true;
+}
+
+void sendStreamAck(CommandOrigin origin) {
+  JsonDocument response;
+  response[F("type")] = SIGNATURE_STREAM_ACK;
+  response[F("data")][F("received")] = signatureStreamReceived();
+  reply(origin, response);
+}
+
+bool dispatchCommand(JsonDocument &doc, CommandOrigin origin) {
+  Command type = doc[F("type")];
+  markCommand();
+
+  switch (type) {
+    case SIGNATURE_REQUEST: {
+      int keyIndex = doc[F("data")][F("index")];
+      // A request awaiting approval on the portal can't be replaced, nor its reply redirected
+      if(state.status == SIGNING) {
+        replyError(origin, INVALID_SIGNATURE_STREAM, "Signature already pending");
+        return false;
+      }
+      if(!checkAccountKey(keyIndex, doc[F("data")][F("pk")], origin)) {
+        return false;
+      }
+      // A direct request supersedes the origin's own unfinished stream, other clients' streams are left alone
+      if(ownsSignatureStream(origin)) {
+        abortSignatureStream();
+      }
+      JsonArray data_array = doc[F("data")][F("msg")];
+      for (int i = 0; i < 64; i++) {
+        state.currentSignatureRequest.msg[i] = data_array[i];
+      }
+
+      state.currentSignatureRequest.index = keyIndex;
+      state.currentSignatureRequest.length = 64;
+      state.pendingOrigin = origin;
+      state.status = SIGNING;
+      break;
+    }
+    case SIGNATURE_STREAM_START: {
+      int keyIndex = doc[F("data")][F("index")];
+      uint32_t size = doc[F("data")][F("size")];
+      if(state.status == SIGNING) {
+        replyError(origin, INVALID_SIGNATURE_STREAM, "Signature already pending");
+        return false;
+      }
+      if(!checkAccountKey(keyIndex, doc[F("data")][F("pk")], origin)) {
+        return false;
+      }
+      SignatureStreamResult result = startSignatureStream(keyIndex, size, origin);
+      if(result == STREAM_NOT_OWNER) {
+        replyError(origin, INVALID_SIGNATURE_STREAM, "Stream in progress");
+        return false;
+      }
+      if(result == STREAM_INVALID) {
+        replyError(origin, INVALID_SIGNATURE_STREAM, "Could not start hashing");
+        return false;
+      }
+      sendStreamAck(origin);
+      break;
+    }
+    case SIGNATURE_STREAM_CHUNK: {
+      uint8_t chunk[SIGNATURE_CHUNK_SIZE];
+      const char *hex = doc[F("data")][F("data")] | "";
+      size_t length = hexToBytes(hex, chunk, sizeof(chunk));
+      SignatureStreamResult result = updateSignatureStream(chunk, length, origin);
+      if(result == STREAM_NOT_OWNER) {
+        replyError(origin, INVALID_SIGNATURE_STREAM, "No stream started by this client");
+        return false;
+      }
+      if(result == STREAM_INVALID) {
+        abortSignatureStream();
+        replyError(origin, INVALID_SIGNATURE_STREAM, "Invalid chunk");
+        return false;
+      }
+      sendStreamAck(origin);
+      break;
+    }
+    case SIGNATURE_STREAM_END: {
+      int keyIndex;
+      // The digest is written straight into the current request, which must not be awaiting approval
+      if(state.status == SIGNING) {
+        replyError(origin, INVALID_SIGNATURE_STREAM, "Signature already pending");
+        return false;
+      }
+      SignatureStreamResult result = finishSignatureStream(origin, state.currentSignatureRequest.msg, &keyIndex);
+      if(result == STREAM_NOT_OWNER) {
+        replyError(origin, INVALID_SIGNATURE_STREAM, "No stream started by this client");
+        return false;
+      }
+      if(result == STREAM_INVALID) {
+        abortSignatureStream();
+        replyError(origin, INVALID_SIGNATURE_STREAM, "Incomplete payload");
+        return false;
+      }
+      // The digest is signed once the user approves it on the portal
+      state.currentSignatureRequest.index = keyIndex;
+      state.currentSignatureRequest.length = SIGNATURE_DIGEST_SIZE;
+      state.pendingOrigin = origin;
+      state.status = SIGNING;
+      break;
+    }
+    case GET_ACCOUNT_REQUEST: {
+      int index = doc[F("data")][F("index")];
+      // Optional 33 byte compressed public key in the response
+      bool compressed = doc[F("data")][F("compressed")] | false;
+      if(index == -1) {
+        state.pendingOrigin = origin;
+        state.pendingCompressed = compressed;
+        state.status = SELECTING_ACCOUNT;
+      } else {
+        sendAccount(index, origin, compressed);
+      }
+      break;
+    }
+    case GET_ARTIFACT_REQUEST: {
+      // Raw gzip bytes can't travel in WebSocket text frames, the portal serves the artifact over HTTP
+      if(origin.transport != SERIAL_TRANSPORT) {
+        replyError(origin, UNKNOWN, "Artifact is served at /EcdsaRAccount.json.gz");
+        return false;
+      }
+      if(!mountFilesystem()) {
+        replyError(origin, UNKNOWN, "Filesystem unavailable");
+        return false;
+      }
+      char output[1024];
+      File artifact = SPIFFS.open("/EcdsaRAccount.json.gz", "r");
+      JsonDocument responseStart;
+      responseStart[F("type")] = GET_ARTIFACT_RESPONSE_START;
+      responseStart[F("data")][F("size")] = artifact.size();
+      reply(origin, responseStart);
+      ReadBufferingStream bufferedFile{artifact, 64};
+      while(bufferedFile.available()) {
+        size_t bytesRead = bufferedFile.readBytes(output, sizeof(output));
+        Serial.write(output, bytesRead);
+      }
+      artifact.close();
+      Serial.println("");
+      break;
+    }
+    case GET_SENDER_REQUEST: {
+      if(state.status != WAITING_FOR_SENDER_REQUEST) {
+        replyError(origin, INVALID_SENDER_REQUEST, "Unexpected sender request");
+        return false;
+      }
+      JsonDocument response;
+      response[F("data")][F("sender")] = String(state.currentSender);
+      response[F("type")] = GET_SENDER_RESPONSE;
+      reply(origin, response);
+      state.status = IDLE;
+      break;
+    }
+    case GET_MEMORY_STATS_REQUEST: {
+      JsonDocument response;
+      sampleMemory();
+      response[F("type")] = GET_MEMORY_STATS_RESPONSE;
+      serializeMemoryStats(response[F("data")].to<JsonObject>());
+      reply(origin, response);
+      break;
+    }
+    case GET_STATS_REQUEST: {
+      // Optional subscription toggle for periodic pushes
+      if(!doc[F("data")][F("subscribe")].isNull()) {
+        state.statsSubscribed = doc[F("data")][F("subscribe")];
+        state.statsOrigin = origin;
+      }
+      sendStats(origin, false);
+      break;
+    }
+    default:
+      // Unknown command
+      setError(UNKNOWN);
+  }
+  return true;
+}
+
+void replyRaw(CommandOrigin origin, const String &output) {
+  if(origin.transport == WEBSOCKET_TRANSPORT) {
+    sendWebSocketText(origin.clientId, output);
+  } else {
+    Serial.write(output.c_str(), output.length());
+    Serial.println();
+  }
+}
+
+void reply(CommandOrigin origin, JsonDocument &response, bool push) {
+  if(origin.transport == WEBSOCKET_TRANSPORT) {
+    String output;
+    if(push) {
+      output += PUSH_FRAME_PREFIX;
+    }
+    serializeJson(response, output);
+    sendWebSocketText(origin.clientId, output);
+  } else {
+    // Streamed through a small buffer, so replies don't need a worst-case sized stack buffer
+    WriteBufferingStream bufferedSerial{Serial, 64};
+    if(push) {
+      bufferedSerial.print(PUSH_FRAME_PREFIX);
+    }
+    serializeJson(response, bufferedSerial);
+    bufferedSerial.println();
+    bufferedSerial.flush();
+  }
+}
+
+void serializePublicKey(int index, JsonObject data, bool compressed) {
+  JsonArray pk_array = data[F("pk")].to<JsonArray>();
+  if(compressed) {
+    uint8_t pk[COMPRESSED_PUBLIC_KEY_SIZE];
+    readCompressedPublicKey(index, pk);
+    for(int i = 0; i < COMPRESSED_PUBLIC_KEY_SIZE; i++) {
+      pk_array[i] = pk[i];
+    }
+  } else {
+    KeyPair keyPair;
+    readKeyPair(index, &keyPair);
+    for(int i = 0; i < PUBLIC_KEY_SIZE; i++) {
+      pk_array[i] = keyPair.pk[i];
+    }
+  }
+}
+
+void serializeAccount(int index, JsonObject data, bool compressed) {
+  data[F("index")] = index;
+  serializePublicKey(index, data, compressed);
+  JsonArray msk_array = data[F("msk")].to<JsonArray>();
+  JsonArray salt_array = data[F("salt")].to<JsonArray>();
+
+  uint8_t msk[32];
+  readSecretKey(index, msk);
+  for(int i = 0; i < 32; i++) {
+    msk_array[i] = msk[i];
+  }
+  uint8_t salt[32];
+  readSalt(index, salt);
+  for(int i = 0; i < 32; i++) {
+    salt_array[i] = salt[i];
+  }
+}
+
+void serializeSignatureRequest(JsonObject data, bool compressed) {
+  serializePublicKey(state.currentSignatureRequest.index, data, compressed);
+  JsonArray msg = data[F("msg")].to<JsonArray>();
+  for(int i = 0; i < state.currentSignatureRequest.length; i++) {
+    msg[i] = state.currentSignatureRequest.msg[i];
+  }
+  // Streamed payloads are shown as their SHA-256 digest
+  data[F("hashed")] = state.currentSignatureRequest.length == SIGNATURE_DIGEST_SIZE;
+  data[F("index")] = state.currentSignatureRequest.index;
+}
+
+void sendAccount(int index, CommandOrigin origin, bool compressed) {
+    if(!isValidAccountIndex(index)) {
+      JsonDocument response;
+      response[F("type")] = GET_ACCOUNT_REJECTED;
+      reply(origin, response);
+      return;
+    }
+    AccountResponseFormat format = compressed ? COMPRESSED_COMMAND_RESPONSE : COMMAND_RESPONSE;
+    withAccountResponse(index, format, [origin](const String &output) {
+      replyRaw(origin, output);
+    });
+}
+
+void sendSignatureResponse(bool approve, CommandOrigin origin) {
+      JsonDocument response;
+      if(approve) {
+        KeyPair keyPair;
+        readKeyPair(state.currentSignatureRequest.index, &keyPair);
+        uint8_t signature[64];
+        sign(&keyPair, state.currentSignatureRequest.msg, state.currentSignatureRequest.length, signature);
+        response[F("type")] = SIGNATURE_ACCEPTED_RESPONSE;
+        JsonArray jsonSignature = response[F("data")][F("signature")].to<JsonArray>();
+        for(int i = 0; i < 64; i++) {
+          jsonSignature[i] = signature[i];
+        }
+      } else {
+        response[F("type")] = SIGNATURE_REJECTED_RESPONSE;
+      }
+      reply(origin, response);
+}
+
+void sendStats(CommandOrigin origin, bool push) {
+    JsonDocument response;
+    response[F("type")] = GET_STATS_RESPONSE;
+    serializeStats(response[F("data")].to<JsonObject>(), !push);
+    reply(origin, response, push);
+}
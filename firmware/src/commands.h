@@ -0,0 +1,52 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "stats.h"
+#include "state.h"
+#include "board.h"
+#include "config.h"
+#include "curve.h"
+#include "SPIFFS.h"
+#include "StreamUtils.h"
+
+enum Command {
+    SIGNATURE_REQUEST,
+    SIGNATURE_ACCEPTED_RESPONSE,
+    SIGNATURE_REJECTED_RESPONSE,
+    GET_ACCOUNT_REQUEST,
+    GET_ACCOUNT_RESPONSE,
+    GET_ACCOUNT_REJECTED,
+    GET_ARTIFACT_REQUEST,
+    GET_ARTIFACT_RESPONSE_START,
+    GET_SENDER_REQUEST,
+    GET_SENDER_RESPONSE,
+    ERROR,
+    GET_MEMORY_STATS_REQUEST,
+    GET_MEMORY_STATS_RESPONSE,
+    GET_STATS_REQUEST,
+    GET_STATS_RESPONSE,
+    SIGNATURE_STREAM_START,
+    SIGNATURE_STREAM_CHUNK,
+    SIGNATURE_STREAM_END,
+    SIGNATURE_STREAM_ACK,
+};
+
+// Unsolicited frames (periodic stats pushes) are prefixed so hosts
+// waiting for a command response can skip them
+const char PUSH_FRAME_PREFIX = '#';
+
+const CommandOrigin SERIAL_ORIGIN = { SERIAL_TRANSPORT, 0 };
+
+bool dispatchCommand(JsonDocument &doc, CommandOrigin origin);
+void reply(CommandOrigin origin, JsonDocument &response, bool push = false);
+// Sends an already serialized response
+void replyRaw(CommandOrigin origin, const String &output);
+void replyError(CommandOrigin origin, ErrorCode code, const char *message);
+
+void serializeAccount(int index, JsonObject data, bool compressed = false);
+void serializeSignatureRequest(JsonObject data, bool compressed = false);
+
+void sendAccount(int index, CommandOrigin origin, bool compressed = false);
+void sendSignatureResponse(bool approve, CommandOrigin origin);
+void sendStats(CommandOrigin origin, bool push);
@@ -1,24 +1,130 @@
 #include "config.h"
+#include "account_cache.h"
 
 Preferences preferences;
 
+// SPIFFS is mounted on first use, either by the portal task or by a command that needs it
+SemaphoreHandle_t filesystemLock;
+bool filesystemMounted = false;
+
+// Expanded public keys, so each stored key is decompressed at most once per boot
+uint8_t expandedPublicKeys[MAX_ACCOUNTS][PUBLIC_KEY_SIZE];
+bool expandedPublicKeysValid[MAX_ACCOUNTS];
+// Keys are written from the portal (async_tcp) and read from both it and the loop task,
+// the lock keeps a fill from decompressing a half written key
+SemaphoreHandle_t keyLock;
+
+void readStoredPublicKey(int index, uint8_t *pk) {
+  for(int i = 0; i < COMPRESSED_PUBLIC_KEY_SIZE; i++) {
+    pk[i] = EEPROM.read(PUBLIC_KEYS_OFFSET + index * COMPRESSED_PUBLIC_KEY_SIZE + i);
+  }
+}
+
 void writeKeyPair(int index, KeyPair *keyPair){ 
+  if(!isValidAccountIndex(index)) {
+    return;
+  }
+  uint8_t compressed[COMPRESSED_PUBLIC_KEY_SIZE];
+  compressPublicKey(keyPair->pk, compressed);
+  xSemaphoreTake(keyLock, portMAX_DELAY);
   for(int i = 0; i < 32; i++) {
     EEPROM.write(index * 32 + i, keyPair->sk[i] & 0xFF);
   }
-  for(int i = 0; i < 64; i++) {
-    EEPROM.write(PUBLIC_KEYS_OFFSET + index * 64 + i, keyPair->pk[i] & 0xFF);
+  for(int i = 0; i < COMPRESSED_PUBLIC_KEY_SIZE; i++) {
+    EEPROM.write(PUBLIC_KEYS_OFFSET + index * COMPRESSED_PUBLIC_KEY_SIZE + i, compressed[i]);
   }
   EEPROM.commit();
+  memcpy(expandedPublicKeys[index], keyPair->pk, PUBLIC_KEY_SIZE);
+  expandedPublicKeysValid[index] = true;
+  xSemaphoreGive(keyLock);
+  // After the write, so a response built from the old key meanwhile is dropped
+  invalidateAccount(index);
+}
+
+void readCompressedPublicKey(int index, uint8_t *pk) {
+  // Out of range accounts read as uninitialized
+  if(!isValidAccountIndex(index)) {
+    memset(pk, 0xFF, COMPRESSED_PUBLIC_KEY_SIZE);
+    return;
+  }
+  xSemaphoreTake(keyLock, portMAX_DELAY);
+  readStoredPublicKey(index, pk);
+  xSemaphoreGive(keyLock);
 }
 
 void readKeyPair(int index, KeyPair *keyPair) {
+  // Out of range accounts read as uninitialized
+  if(!isValidAccountIndex(index)) {
+    memset(keyPair->sk, 0xFF, sizeof(keyPair->sk));
+    memset(keyPair->pk, 0xFF, sizeof(keyPair->pk));
+    return;
+  }
+  xSemaphoreTake(keyLock, portMAX_DELAY);
   for(int i = 0; i < 32; i++) {
     keyPair->sk[i] = EEPROM.read(index * 32 + i);
   }
-  for(int i = 0; i < 64; i++) {
-    keyPair->pk[i] = EEPROM.read(PUBLIC_KEYS_OFFSET + index * 64 + i);
+  if(!expandedPublicKeysValid[index]) {
+    uint8_t compressed[COMPRESSED_PUBLIC_KEY_SIZE];
+    readStoredPublicKey(index, compressed);
+    // Uninitialized accounts keep reading as all 0xFF
+    if(compressed[0] == 0xFF) {
+      memset(expandedPublicKeys[index], 0xFF, PUBLIC_KEY_SIZE);
+    } else {
+      decompressPublicKey(compressed, expandedPublicKeys[index]);
+    }
+    expandedPublicKeysValid[index] = true;
   }
+  memcpy(keyPair->pk, expandedPublicKeys[index], PUBLIC_KEY_SIZE);
+  xSemaphoreGive(keyLock);
+}
+
+// Rewrites public keys compressed and moves msk and salt down to the compressed layout
+void migrateStorage() {
+  uint8_t pks[MAX_ACCOUNTS][PUBLIC_KEY_SIZE];
+  uint8_t msks[MAX_ACCOUNTS][32];
+  uint8_t salts[MAX_ACCOUNTS][32];
+  for(int index = 0; index < MAX_ACCOUNTS; index++) {
+    for(int i = 0; i < PUBLIC_KEY_SIZE; i++) {
+      pks[index][i] = EEPROM.read(PUBLIC_KEYS_OFFSET + index * PUBLIC_KEY_SIZE + i);
+    }
+    for(int i = 0; i < 32; i++) {
+      msks[index][i] = EEPROM.read(LEGACY_SECRET_KEYS_OFFSET + index * 32 + i);
+      salts[index][i] = EEPROM.read(LEGACY_SALT_OFFSET + index * 32 + i);
+    }
+  }
+  for(int index = 0; index < MAX_ACCOUNTS; index++) {
+    uint8_t compressed[COMPRESSED_PUBLIC_KEY_SIZE];
+    bool empty = true;
+    for(int i = 0; i < PUBLIC_KEY_SIZE; i++) {
+      empty &= (pks[index][i] == 255);
+    }
+    if(empty) {
+      memset(compressed, 0xFF, COMPRESSED_PUBLIC_KEY_SIZE);
+    } else {
+      compressPublicKey(pks[index], compressed);
+    }
+    for(int i = 0; i < COMPRESSED_PUBLIC_KEY_SIZE; i++) {
+      EEPROM.write(PUBLIC_KEYS_OFFSET + index * COMPRESSED_PUBLIC_KEY_SIZE + i, compressed[i]);
+    }
+    for(int i = 0; i < 32; i++) {
+      EEPROM.write(SECRET_KEYS_OFFSET + index * 32 + i, msks[index][i]);
+      EEPROM.write(SALT_OFFSET + index * 32 + i, salts[index][i]);
+    }
+  }
+  for(int i = 0; i < LAYOUT_MARKER_SIZE; i++) {
+    EEPROM.write(LAYOUT_MARKER_OFFSET + i, LAYOUT_MARKER[i]);
+  }
+  // Single commit, so a power loss leaves either the legacy or the migrated layout
+  EEPROM.commit();
+}
+
+bool isStorageMigrated() {
+  for(int i = 0; i < LAYOUT_MARKER_SIZE; i++) {
+    if(EEPROM.read(LAYOUT_MARKER_OFFSET + i) != LAYOUT_MARKER[i]) {
+      return false;
+    }
+  }
+  return true;
 }
 
 void readSecretKey(int index, uint8_t *msk) {
@@ -44,6 +150,7 @@ bool readPassword(char *password) {
 }
 
 void readContractClassId(uint8_t *contractClassId) {
+  mountFilesystem();
   File artifact = SPIFFS.open("/EcdsaRAccount.classId", "r");
   artifact.readBytes((char*)contractClassId, 32);
   artifact.close();
@@ -55,6 +162,10 @@ void readSSID(char *SSID) {
 }
 
 void writeSecretKey(int index, uint8_t *msk) {
+  if(!isValidAccountIndex(index)) {
+    return;
+  }
+  invalidateAccount(index);
   for(int i = 0; i < 32; i++) {
     EEPROM.write(SECRET_KEYS_OFFSET + index * 32 + i, msk[i] & 0xFF);
   }
@@ -62,6 +173,10 @@ void writeSecretKey(int index, uint8_t *msk) {
 }
 
 void writeSalt(int index, uint8_t *salt) {
+  if(!isValidAccountIndex(index)) {
+    return;
+  }
+  invalidateAccount(index);
   for(int i = 0; i < 32; i++) {
     EEPROM.write(SALT_OFFSET + index * 32 + i, salt[i] & 0xFF);
   }
@@ -77,8 +192,23 @@ void writeSSID(const char *ssid) {
 }
 
 void setupStorage() {
-  EEPROM.begin(MAX_ACCOUNTS * (32+64+32+32));
+  EEPROM.begin(EEPROM_SIZE);
+  keyLock = xSemaphoreCreateMutex();
   preferences.begin("keychain", false);
+  if(!isStorageMigrated()) {
+    migrateStorage();
+  }
+  filesystemLock = xSemaphoreCreateMutex();
+}
+
+bool mountFilesystem() {
+  xSemaphoreTake(filesystemLock, portMAX_DELAY);
+  if(!filesystemMounted) {
+    // Formats on first boot, which can take seconds
+    filesystemMounted = SPIFFS.begin(true);
+  }
+  xSemaphoreGive(filesystemLock);
+  return filesystemMounted;
 }
 
 void closeStorage() {
@@ -10,18 +10,35 @@
 
 #define MAX_ACCOUNTS 5
 
+// Public keys are stored compressed. Uninitialized slots read as all 0xFF
 #define PUBLIC_KEYS_OFFSET (MAX_ACCOUNTS * 32)
-#define SECRET_KEYS_OFFSET ((PUBLIC_KEYS_OFFSET) + MAX_ACCOUNTS * 64)
+#define SECRET_KEYS_OFFSET ((PUBLIC_KEYS_OFFSET) + MAX_ACCOUNTS * COMPRESSED_PUBLIC_KEY_SIZE)
 #define SALT_OFFSET ((SECRET_KEYS_OFFSET) + MAX_ACCOUNTS * 32)
 
+// Layout with uncompressed public keys, kept to migrate existing devices
+#define LEGACY_SECRET_KEYS_OFFSET ((PUBLIC_KEYS_OFFSET) + MAX_ACCOUNTS * PUBLIC_KEY_SIZE)
+#define LEGACY_SALT_OFFSET ((LEGACY_SECRET_KEYS_OFFSET) + MAX_ACCOUNTS * 32)
+#define EEPROM_SIZE (MAX_ACCOUNTS * (32+64+32+32))
+
+// Written in the spare bytes after the salts, committed together with the migrated data
+#define LAYOUT_MARKER_OFFSET ((SALT_OFFSET) + MAX_ACCOUNTS * 32)
+#define LAYOUT_MARKER_SIZE 4
+#define LAYOUT_MARKER "KCv2"
+static_assert(LAYOUT_MARKER_OFFSET + LAYOUT_MARKER_SIZE <= EEPROM_SIZE, "Layout marker must fit in EEPROM");
+
+inline bool isValidAccountIndex(int index) {
+    return index >= 0 && index < MAX_ACCOUNTS;
+}
+
 struct Config {
     u_int8_t private_keys[MAX_ACCOUNTS][32];
-    u_int8_t public_keys[MAX_ACCOUNTS][64];
+    u_int8_t public_keys[MAX_ACCOUNTS][COMPRESSED_PUBLIC_KEY_SIZE];
 };
 
 extern Config config;
 
 void readKeyPair(int index, KeyPair *keyPair);
+void readCompressedPublicKey(int index, uint8_t *pk);
 void readSecretKey(int index, uint8_t *msk);
 void readSalt(int index, uint8_t *salt);
 bool readPassword(char *password);
@@ -35,4 +52,5 @@ void writePassword(const char *password);
 void writeSSID(const char *ssid);
 
 void setupStorage();
+bool mountFilesystem();
 void closeStorage();
\ No newline at end of file
@@ -38,9 +38,19 @@ void generateKeyPair(KeyPair *keyPair) {
   uECC_make_key(keyPair->pk, keyPair->sk, curve);
 }
 
-void sign(KeyPair *keyPair, uint8_t *message, uint8_t *signature) {
-  uECC_sign(keyPair->sk, message, 64, signature, curve);
-  int result = uECC_verify(keyPair->pk, message, 64, signature, curve);
+void compressPublicKey(const uint8_t *pk, uint8_t *compressed) {
+  uECC_compress(pk, compressed, curve);
+}
+
+void decompressPublicKey(const uint8_t *compressed, uint8_t *pk) {
+  unsigned long start = micros();
+  uECC_decompress(compressed, pk, curve);
+  recordKeyDecompression(micros() - start);
+}
+
+void sign(KeyPair *keyPair, uint8_t *message, unsigned length, uint8_t *signature) {
+  uECC_sign(keyPair->sk, message, length, signature, curve);
+  int result = uECC_verify(keyPair->pk, message, length, signature, curve);
   if(!result) {
     setError(FAILED_VERIFICATION);
   }
@@ -5,6 +5,9 @@
 #include "board.h"
 #include "stats.h"
 
+const int PUBLIC_KEY_SIZE = 64;
+const int COMPRESSED_PUBLIC_KEY_SIZE = 33;
+
 struct KeyPair {
     uint8_t sk[32];
     uint8_t pk[64];
@@ -13,4 +16,6 @@ struct KeyPair {
 int RNG(uint8_t *dest, unsigned size);
 void setupCurve(); 
 void generateKeyPair(KeyPair *keyPair);
-void sign(KeyPair *keyPair, uint8_t *message, uint8_t *signature);
+void compressPublicKey(const uint8_t *pk, uint8_t *compressed);
+void decompressPublicKey(const uint8_t *compressed, uint8_t *pk);
+void sign(KeyPair *keyPair, uint8_t *message, unsigned length, uint8_t *signature);
@@ -5,6 +5,7 @@
 #include "scheduler.h"
 #include "serial_commands.h"
 #include "captive_portal.h"
+#include "account_cache.h"
 
 #define DEBUG
 
@@ -22,48 +23,34 @@ void ONSequence() {
   };
 }
 
-task tasks[N_TASKS] = { readCommands, doServerWork, printStats };
-
 void loop() {
-  schedule(tasks);
+  schedule();
 }
 
 void setup() {
+  // Serial first, so the port is up while the rest boots
+  Serial.begin(115200);
+  Serial.setRxBufferSize(1024);
+  Serial.setTxBufferSize(1024);
+  markBootPhase(BOOT_SERIAL);
+
   pinMode(BUTTON, INPUT_PULLDOWN);
+  setupScheduler();
 
   ONSequence();
+  markBootPhase(BOOT_BUTTON);
   setupCurve();
+  markBootPhase(BOOT_CURVE);
   setupStorage();
+  setupAccountCache();
+  markBootPhase(BOOT_STORAGE);
 
+  // Filesystem and WiFi are deferred, doServerWork is enabled once the portal is up
   if(state.setupMode) {
-    state.activeTasks[1] = true;
+    startPortal();
   }
 
-  Serial.begin(115200);
-  Serial.setRxBufferSize(1024);
-  Serial.setTxBufferSize(1024);
-
-  if(state.activeTasks[1]) {
-    if(!SPIFFS.begin(true)){
-      Serial.println(F("An Error has occurred while mounting SPIFFS"));
-      return;
-    }
-    char SSID[32];
-    readSSID(SSID);
-
-    char password[32];
-
-    if(!readPassword(password)) {
-      WiFi.softAP(String(SSID).c_str());
-    } else {
-      WiFi.softAP(String(SSID).c_str(), String(password).c_str());
-    }
-    setupServer();
-    #ifdef DEBUG
-    Serial.println(F("Setup mode"));
-    #endif
-  } 
-
+  markBootPhase(BOOT_READY);
   #ifdef DEBUG
   Serial.println(F("Keychain ready"));
   #endif
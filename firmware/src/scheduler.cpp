@@ -1,30 +1,48 @@
 #include "scheduler.h"
+#include "tasks.h"
+#include <utility>
 
 // Scheduler
 
-const unsigned long periods[N_TASKS] = { 100, 50, 2000 };
+template<int i>
+inline void runTask() {
+  // Compile-time task definition, so the call below is direct and can be inlined
+  constexpr TaskDef def = TASKS[i];
+  unsigned long now = micros();
+  if(state.activeTasks[i] && (now >= state.nextRun[i])) {
+    TaskResult result = def.run(now);
+    if(result.success) {
+      stats.successes[i]++;
+    } else {
+      stats.failures[i]++;
+    }
+    state.nextRun[i] = now + def.period * 1000UL + result.offset;
+    unsigned long end = micros();
+    unsigned long ellapsed = end - now;
+    stats.times[i]+=ellapsed;
+    if(stats.maxTimes[i] < ellapsed) {
+      stats.maxTimes[i] = ellapsed;
+    } 
+    if (stats.minTimes[i] > ellapsed) {
+      stats.minTimes[i] = ellapsed;
+    }
+  }
+}
 
-void schedule(task tasks[N_TASKS]) {
+template<int... I>
+inline void runTasks(std::integer_sequence<int, I...>) {
+  (runTask<I>(), ...);
+}
+
+void setupScheduler() {
   for(int i = 0; i < N_TASKS; i++) {
-    unsigned long now = micros();
-    if(state.activeTasks[i] && (now >= state.nextRun[i])) {
-      TaskResult result = tasks[i](now);
-      if(result.success) {
-        stats.successes[i]++;
-      } else {
-        stats.failures[i]++;
-      }
-      state.nextRun[i] = now + periods[i]*1e3 + result.offset;
-      unsigned long end = micros();
-      unsigned long ellapsed = end - now;
-      stats.times[i]+=ellapsed;
-      if(stats.maxTimes[i] < ellapsed) {
-        stats.maxTimes[i] = ellapsed;
-      } 
-      if (stats.minTimes[i] > ellapsed) {
-        stats.minTimes[i] = ellapsed;
-      }
-    }
+    state.activeTasks[i] = TASKS[i].enabled;
+    state.nextRun[i] = 0;
   }
+  resetStats();
+}
+
+void schedule() {
+  runTasks(std::make_integer_sequence<int, N_TASKS>{});
   stats.loops++;
-}
\ No newline at end of file
+}
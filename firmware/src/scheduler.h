@@ -5,4 +5,5 @@
 #include "state.h"
 
 typedef TaskResult (*task)(unsigned long);
-void schedule(task tasks[]);
\ No newline at end of file
+void setupScheduler();
+void schedule();
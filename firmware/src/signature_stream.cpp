@@ -0,0 +1,78 @@
+#include "signature_stream.h"
+
+struct SignatureStream {
+    bool active;
+    int index;
+    // Announced and received payload sizes in bytes
+    uint32_t size;
+    uint32_t received;
+    CommandOrigin origin;
+    mbedtls_sha256_context sha;
+};
+
+SignatureStream signatureStream;
+
+bool ownsSignatureStream(CommandOrigin origin) {
+  return signatureStream.active && sameOrigin(origin, signatureStream.origin);
+}
+
+SignatureStreamResult startSignatureStream(int index, uint32_t size, CommandOrigin origin) {
+  if(signatureStream.active && !ownsSignatureStream(origin)) {
+    return STREAM_NOT_OWNER;
+  }
+  // A new start from the same origin replaces its unfinished stream
+  abortSignatureStream();
+  mbedtls_sha256_init(&signatureStream.sha);
+  if(mbedtls_sha256_starts(&signatureStream.sha, 0) != 0) {
+    mbedtls_sha256_free(&signatureStream.sha);
+    return STREAM_INVALID;
+  }
+  signatureStream.active = true;
+  signatureStream.index = index;
+  signatureStream.size = size;
+  signatureStream.received = 0;
+  signatureStream.origin = origin;
+  return STREAM_OK;
+}
+
+SignatureStreamResult updateSignatureStream(const uint8_t *data, size_t length, CommandOrigin origin) {
+  if(!ownsSignatureStream(origin)) {
+    return STREAM_NOT_OWNER;
+  }
+  if(length == 0 || signatureStream.received + length > signatureStream.size) {
+    return STREAM_INVALID;
+  }
+  if(mbedtls_sha256_update(&signatureStream.sha, data, length) != 0) {
+    return STREAM_INVALID;
+  }
+  signatureStream.received += length;
+  return STREAM_OK;
+}
+
+SignatureStreamResult finishSignatureStream(CommandOrigin origin, uint8_t *digest, int *index) {
+  if(!ownsSignatureStream(origin)) {
+    return STREAM_NOT_OWNER;
+  }
+  if(signatureStream.received != signatureStream.size) {
+    return STREAM_INVALID;
+  }
+  bool success = mbedtls_sha256_finish(&signatureStream.sha, digest) == 0;
+  *index = signatureStream.index;
+  abortSignatureStream();
+  return success ? STREAM_OK : STREAM_INVALID;
+}
+
+void abortSignatureStream() {
+  if(signatureStream.active) {
+    mbedtls_sha256_free(&signatureStream.sha);
+    signatureStream.active = false;
+  }
+}
+
+bool signatureStreamActive() {
+  return signatureStream.active;
+}
+
+uint32_t signatureStreamReceived() {
+  return signatureStream.received;
+}
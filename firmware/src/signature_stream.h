@@ -0,0 +1,28 @@
+#pragma once
+
+#include <Arduino.h>
+#include "mbedtls/sha256.h"
+#include "state.h"
+
+// Largest payload chunk accepted per SIGNATURE_STREAM_CHUNK, sent as hex so a
+// chunk command fits the serial RX buffer
+const size_t SIGNATURE_CHUNK_SIZE = 256;
+const size_t SIGNATURE_DIGEST_SIZE = 32;
+
+enum SignatureStreamResult {
+    STREAM_OK,
+    // No stream active for this origin, or another client's stream is in progress. That stream is left untouched
+    STREAM_NOT_OWNER,
+    // The origin's own stream received bad data and should be aborted
+    STREAM_INVALID
+};
+
+// Payloads of any size are hashed as they arrive (SHA-256 runs on the hardware
+// accelerator through mbedtls), so RAM use doesn't depend on the payload size
+SignatureStreamResult startSignatureStream(int index, uint32_t size, CommandOrigin origin);
+SignatureStreamResult updateSignatureStream(const uint8_t *data, size_t length, CommandOrigin origin);
+SignatureStreamResult finishSignatureStream(CommandOrigin origin, uint8_t *digest, int *index);
+void abortSignatureStream();
+bool signatureStreamActive();
+bool ownsSignatureStream(CommandOrigin origin);
+uint32_t signatureStreamReceived();
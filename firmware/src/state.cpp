@@ -8,11 +8,19 @@ State state = {
     // Status
     IDLE,
     // Next time tasks should be run in us
-    { 0, 0, 0 },
-    // Active tasks
-    { 1, 1, 1 },
+    { 0 },
+    // Active tasks, set from TASKS by setupScheduler()
+    { 0 },
     // Current signature request
-    { 0, { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,0, 0, 0, 0, 0, 0, 0, 0 } },
+    { 0, { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,0, 0, 0, 0, 0, 0, 0, 0 }, 64 },
     // Current sender
-    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 }
+    { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    // Stats subscription
+    false,
+    // Stats origin
+    { SERIAL_TRANSPORT, 0 },
+    // Pending request origin
+    { SERIAL_TRANSPORT, 0 },
+    // Pending compressed account
+    false
 };
\ No newline at end of file
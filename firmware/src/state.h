@@ -11,9 +11,27 @@ enum KeyChainStatus {
     WAITING_FOR_SENDER_REQUEST,
 };
 
+enum Transport {
+    SERIAL_TRANSPORT,
+    WEBSOCKET_TRANSPORT,
+};
+
+// Channel a command came from, so replies (even deferred ones) go back to it
+struct CommandOrigin {
+    Transport transport;
+    // WebSocket client id, unused for serial
+    uint32_t clientId;
+};
+
+inline bool sameOrigin(CommandOrigin a, CommandOrigin b) {
+    return a.transport == b.transport && a.clientId == b.clientId;
+}
+
 struct CurrentSignatureRequest {
     int index;
     uint8_t msg[64];
+    // Bytes of msg to sign, 64 for raw requests or 32 for a streamed payload digest
+    uint8_t length;
 };
 
 struct State {
@@ -31,6 +49,14 @@ struct State {
     CurrentSignatureRequest currentSignatureRequest;
     // Current sender
     char currentSender[67];
+    // Whether the host asked for periodic stats pushes
+    bool statsSubscribed;
+    // Origin of the stats subscription
+    CommandOrigin statsOrigin;
+    // Origin of the pending account selection or signature request
+    CommandOrigin pendingOrigin;
+    // Whether the pending account selection asked for a compressed public key
+    bool pendingCompressed;
 };
 
 extern State state;
\ No newline at end of file
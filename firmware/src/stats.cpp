@@ -1,35 +1,83 @@
 #include "stats.h"
+#include "commands.h"
+#include "tasks.h"
 
-char *TASK_NAMES[] = { "readCommands", "doServerWork", "printStats" };
+const char *BOOT_PHASE_NAMES[BOOT_PHASES] = { "serial", "button", "curve", "storage", "ready", "filesystem", "wifi", "server" };
+const char *MONITORED_TASK_NAMES[N_MONITORED_TASKS] = { "loopTask", "async_tcp", "async_udp" };
 
 unsigned long lastRun = 0;
+// Guards the counters updated from the async_udp and async_tcp tasks (window stats and keyStats)
+portMUX_TYPE statsLock = portMUX_INITIALIZER_UNLOCKED;
+portMUX_TYPE memoryStatsLock = portMUX_INITIALIZER_UNLOCKED;
 
+// Sized by N_TASKS, min times are primed by resetStats() in setupScheduler()
 Stats stats = {
     // Successes
-    { 0, 0, 0 },
+    { 0 },
     // Failures
-    { 0, 0, 0 },
+    { 0 },
     // Times
-    { 0, 0, 0 },
-    { 0, 0, 0 },
-    { 10000000, 10000000, 10000000 },
+    { 0 },
+    { 0 },
+    { 0 },
     // Loops
     0,
     // Errors
-    { 0 }
+    { 0 },
+    // DNS queries, times and max time
+    0,
+    0,
+    0
+};
+
+// Raw stats of the last completed window
+Stats lastStats = stats;
+
+BootStats bootStats = {
+    // Phases
+    { 0 },
+    // First command
+    0,
+    // Failed phase
+    BOOT_PHASES
+};
+
+KeyStats keyStats = {
+    // Decompressions
+    0,
+    // Last and max decompression time
+    0,
+    0
 };
 
 ComputedStats computedStats = {
     // Task frequencies
-    { 0, 0, 0 },
+    { 0 },
     // Task mean times
-    { 0, 0, 0 },
+    { 0 },
     // Task ratios
-    { 0, 0, 0},
+    { 0 },
     // Loop frequency
     0,
     // Errors per second
-    { 0  }
+    { 0  },
+    // DNS query rate and mean time
+    0,
+    0
+};
+
+MemoryStats memoryStats = {
+    // Heap
+    0,
+    0,
+    0,
+    // Stack high-water marks
+    { 0, 0, 0 },
+    // Min-ever values
+    UINT32_MAX,
+    UINT32_MAX,
+    0,
+    { UINT32_MAX, UINT32_MAX, UINT32_MAX }
 };
 
 void resetStats() {
@@ -44,10 +92,49 @@ void resetStats() {
     for(int i = 0; i < ERROR_TYPES; i++) {
         stats.errors[i] = 0;
     }
+    stats.dnsQueries = 0;
+    stats.dnsTimes = 0;
+    stats.dnsMaxTime = 0;
+}
+
+void recordDnsQuery(unsigned long ellapsed) {
+  portENTER_CRITICAL(&statsLock);
+  stats.dnsQueries++;
+  stats.dnsTimes += ellapsed;
+  if(stats.dnsMaxTime < ellapsed) {
+    stats.dnsMaxTime = ellapsed;
+  }
+  portEXIT_CRITICAL(&statsLock);
+}
+
+void recordKeyDecompression(unsigned long ellapsed) {
+  portENTER_CRITICAL(&statsLock);
+  keyStats.decompressions++;
+  keyStats.lastDecompressTime = ellapsed;
+  if(keyStats.maxDecompressTime < ellapsed) {
+    keyStats.maxDecompressTime = ellapsed;
+  }
+  portEXIT_CRITICAL(&statsLock);
+}
+
+void markBootPhase(BootPhase phase) {
+  bootStats.phases[phase] = micros();
+}
+
+void markBootFailure(BootPhase phase) {
+  bootStats.failedPhase = phase;
+}
+
+void markCommand() {
+  if(bootStats.firstCommand == 0) {
+    bootStats.firstCommand = micros();
+  }
 }
 
 void setError(ErrorCode code) {
+  portENTER_CRITICAL(&statsLock);
   stats.errors[code]++;
+  portEXIT_CRITICAL(&statsLock);
 }
 
 char* getReason(ErrorCode code) {
@@ -60,11 +147,74 @@ char* getReason(ErrorCode code) {
       return "Failed verification";
     case INVALID_SENDER_REQUEST:
       return "Invalid sender request";
+    case INVALID_SIGNATURE_STREAM:
+      return "Invalid signature stream";
     default:
       return "Unknown error";
   }
 }
 
+void sampleMemory() {
+  // Read outside the critical section, heap and task queries take their own locks
+  uint32_t freeHeap = ESP.getFreeHeap();
+  uint32_t largestFreeBlock = ESP.getMaxAllocHeap();
+  float fragmentation = freeHeap == 0 ? 0 :
+    100.0 - (largestFreeBlock * 100.0) / freeHeap;
+  bool running[N_MONITORED_TASKS];
+  uint32_t stackHighWaterMarks[N_MONITORED_TASKS];
+  for(int i = 0; i < N_MONITORED_TASKS; i++) {
+    // Tasks that are not running (e.g. async_tcp outside setup mode) report 0
+    TaskHandle_t handle = xTaskGetHandle(MONITORED_TASK_NAMES[i]);
+    running[i] = handle != NULL;
+    stackHighWaterMarks[i] = running[i] ? uxTaskGetStackHighWaterMark(handle) : 0;
+  }
+
+  // Sampled from both the loop task and the /stats/memory handler on async_tcp
+  portENTER_CRITICAL(&memoryStatsLock);
+  memoryStats.freeHeap = freeHeap;
+  memoryStats.largestFreeBlock = largestFreeBlock;
+  memoryStats.fragmentation = fragmentation;
+  if(memoryStats.freeHeap < memoryStats.minFreeHeap) {
+    memoryStats.minFreeHeap = memoryStats.freeHeap;
+  }
+  if(memoryStats.largestFreeBlock < memoryStats.minLargestFreeBlock) {
+    memoryStats.minLargestFreeBlock = memoryStats.largestFreeBlock;
+  }
+  if(memoryStats.fragmentation > memoryStats.maxFragmentation) {
+    memoryStats.maxFragmentation = memoryStats.fragmentation;
+  }
+  for(int i = 0; i < N_MONITORED_TASKS; i++) {
+    memoryStats.stackHighWaterMarks[i] = stackHighWaterMarks[i];
+    if(running[i] && stackHighWaterMarks[i] < memoryStats.minStackHighWaterMarks[i]) {
+      memoryStats.minStackHighWaterMarks[i] = stackHighWaterMarks[i];
+    }
+  }
+  portEXIT_CRITICAL(&memoryStatsLock);
+}
+
+void serializeMemoryStats(JsonObject root, bool full) {
+  portENTER_CRITICAL(&memoryStatsLock);
+  MemoryStats sample = memoryStats;
+  portEXIT_CRITICAL(&memoryStatsLock);
+  JsonObject heap = root[F("heap")].to<JsonObject>();
+  heap[F("free")] = sample.freeHeap;
+  heap[F("largestFreeBlock")] = sample.largestFreeBlock;
+  heap[F("fragmentation")] = sample.fragmentation;
+  heap[F("minFree")] = sample.minFreeHeap;
+  heap[F("minLargestFreeBlock")] = sample.minLargestFreeBlock;
+  heap[F("maxFragmentation")] = sample.maxFragmentation;
+  JsonArray stacks = root[F("stacks")].to<JsonArray>();
+  for(int i = 0; i < N_MONITORED_TASKS; i++) {
+    JsonObject stack = stacks.add<JsonObject>();
+    if(full) {
+      stack[F("task")] = MONITORED_TASK_NAMES[i];
+    }
+    stack[F("highWaterMark")] = sample.stackHighWaterMarks[i];
+    // Never sampled tasks report 0
+    stack[F("minHighWaterMark")] = sample.minStackHighWaterMarks[i] == UINT32_MAX ? 0 : sample.minStackHighWaterMarks[i];
+  }
+}
+
 void computeStats(unsigned long now) {
   // In seconds
   float ellapsed = (now - lastRun)/1e6;
@@ -72,49 +222,82 @@ void computeStats(unsigned long now) {
     if(!state.activeTasks[i]) {
         continue;
     }
-    long executions = stats.successes[i] + stats.failures[i];
-    computedStats.taskFrequencies[i] = stats.successes[i] / ellapsed;
-    computedStats.taskMeanTimes[i] = stats.times[i] / (float)executions;
-    computedStats.taskRatios[i] = stats.successes[i]/(float)executions;
+    long executions = lastStats.successes[i] + lastStats.failures[i];
+    computedStats.taskFrequencies[i] = lastStats.successes[i] / ellapsed;
+    computedStats.taskMeanTimes[i] = lastStats.times[i] / (float)executions;
+    computedStats.taskRatios[i] = lastStats.successes[i]/(float)executions;
   }
-  computedStats.loopFrequency = stats.loops / ellapsed;
+  computedStats.loopFrequency = lastStats.loops / ellapsed;
   for(int i = 0; i < ERROR_TYPES; i++) {
-    computedStats.errorsPerSecond[i] = stats.errors[i] / ellapsed;
+    computedStats.errorsPerSecond[i] = lastStats.errors[i] / ellapsed;
   }
+  computedStats.dnsQueryRate = lastStats.dnsQueries / ellapsed;
+  computedStats.dnsMeanTime = lastStats.dnsQueries == 0 ? 0 : lastStats.dnsTimes / (float)lastStats.dnsQueries;
   lastRun = now;
+  sampleMemory();
 }
 
-TaskResult printStats(unsigned long now) {
-  computeStats(now);
-  #ifdef DEBUG
-  char titleBuffer[150];
-  sprintf(titleBuffer, "%-23s | %8s | %8s | %11s | %8s | %3s", "Task", "Freq", "Min", "Mean", "Max", "Ratio");
-  Serial.println(titleBuffer);
-  Serial.println(F("-----------------------------------------------------------------------------"));
+void serializeStats(JsonObject root, bool full) {
+  root[F("loopFrequency")] = computedStats.loopFrequency;
+  JsonArray tasks = root[F("tasks")].to<JsonArray>();
   for(int i = 0; i < N_TASKS; i++) {
-    if(!state.activeTasks[i]) {
-        continue;
+    JsonObject task = tasks.add<JsonObject>();
+    long executions = lastStats.successes[i] + lastStats.failures[i];
+    if(full) {
+      task[F("name")] = TASKS[i].name;
     }
-    char prBuffer[150];
-    sprintf(prBuffer, "%-23s | %6.2fHz | %6dus | ~%8.2fus | %6dus | %.2f", TASK_NAMES[i], computedStats.taskFrequencies[i], stats.minTimes[i], computedStats.taskMeanTimes[i], stats.maxTimes[i], computedStats.taskRatios[i]);
-    Serial.print(prBuffer);
-    Serial.println("");
-  }
-  Serial.println(F("-----------------------------------------------------------------------------"));
-  Serial.print(F("Loop frequency: "));
-  Serial.print(computedStats.loopFrequency);
-  Serial.println(F("Hz"));
-  Serial.println("");
-  sprintf(titleBuffer, "%-23s | %8s", "Error code", "Count/s");
-  Serial.println(titleBuffer);
-  Serial.println(F("-------------------------------------"));
+    task[F("active")] = state.activeTasks[i];
+    task[F("successes")] = lastStats.successes[i];
+    task[F("failures")] = lastStats.failures[i];
+    task[F("frequency")] = computedStats.taskFrequencies[i];
+    task[F("min")] = executions == 0 ? 0 : lastStats.minTimes[i];
+    task[F("mean")] = computedStats.taskMeanTimes[i];
+    task[F("max")] = lastStats.maxTimes[i];
+    task[F("ratio")] = computedStats.taskRatios[i];
+  }
+  JsonArray errors = root[F("errors")].to<JsonArray>();
+  JsonArray errorsPerSecond = root[F("errorsPerSecond")].to<JsonArray>();
   for(int i = 0; i < ERROR_TYPES; i++) {
-    char prBuffer[150];
-    sprintf(prBuffer, "%-23s | %5.2f", getReason((ErrorCode)i), computedStats.errorsPerSecond[i]);
-    Serial.println(prBuffer);
+    errors.add(lastStats.errors[i]);
+    errorsPerSecond.add(computedStats.errorsPerSecond[i]);
   }
-  Serial.println(F("-------------------------------------"));
-  #endif
+  JsonObject dns = root[F("dns")].to<JsonObject>();
+  dns[F("queries")] = lastStats.dnsQueries;
+  dns[F("rate")] = computedStats.dnsQueryRate;
+  dns[F("mean")] = computedStats.dnsMeanTime;
+  dns[F("max")] = lastStats.dnsMaxTime;
+  JsonObject keys = root[F("keys")].to<JsonObject>();
+  portENTER_CRITICAL(&statsLock);
+  KeyStats keySample = keyStats;
+  portEXIT_CRITICAL(&statsLock);
+  keys[F("decompressions")] = keySample.decompressions;
+  keys[F("last")] = keySample.lastDecompressTime;
+  keys[F("max")] = keySample.maxDecompressTime;
+  if(full) {
+    JsonObject boot = root[F("boot")].to<JsonObject>();
+    JsonArray phases = boot[F("phases")].to<JsonArray>();
+    for(int i = 0; i < BOOT_PHASES; i++) {
+      JsonObject phase = phases.add<JsonObject>();
+      phase[F("name")] = BOOT_PHASE_NAMES[i];
+      phase[F("end")] = bootStats.phases[i];
+    }
+    boot[F("firstCommand")] = bootStats.firstCommand;
+    if(bootStats.failedPhase != BOOT_PHASES) {
+      boot[F("failed")] = BOOT_PHASE_NAMES[bootStats.failedPhase];
+    }
+  }
+  serializeMemoryStats(root[F("memory")].to<JsonObject>(), full);
+}
+
+TaskResult collectStats(unsigned long now) {
+  // Keep the completed window so snapshots are consistent with computedStats
+  portENTER_CRITICAL(&statsLock);
+  lastStats = stats;
   resetStats();
+  portEXIT_CRITICAL(&statsLock);
+  computeStats(now);
+  if(state.statsSubscribed) {
+    sendStats(state.statsOrigin, true);
+  }
   return { true, 0 };
 }
\ No newline at end of file
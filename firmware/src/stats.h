@@ -1,17 +1,19 @@
 #pragma once
 
 #include <Arduino.h>
+#include <ArduinoJson.h>
 #include "board.h"
 #include "state.h"
 
-const int ERROR_TYPES = 4;
+const int ERROR_TYPES = 6;
 
 enum ErrorCode {
     UNKNOWN,
     JSON_PARSE,
     INVALID_PK,
     FAILED_VERIFICATION,
-    INVALID_SENDER_REQUEST
+    INVALID_SENDER_REQUEST,
+    INVALID_SIGNATURE_STREAM
 };
 
 struct Stats {
@@ -22,6 +24,10 @@ struct Stats {
     unsigned long minTimes[N_TASKS];
     unsigned long loops;
     unsigned long errors[ERROR_TYPES];
+    // Captive portal DNS, updated from the async_udp task
+    unsigned long dnsQueries;
+    unsigned long dnsTimes;
+    unsigned long dnsMaxTime;
 };
 
 struct ComputedStats {
@@ -30,12 +36,78 @@ struct ComputedStats {
     float taskRatios[N_TASKS];
     float loopFrequency;
     float errorsPerSecond[ERROR_TYPES];
+    float dnsQueryRate;
+    float dnsMeanTime;
+};
+
+// Tasks whose stack headroom is sampled, by FreeRTOS task name
+const int N_MONITORED_TASKS = 3;
+
+struct MemoryStats {
+    // Heap, in bytes
+    uint32_t freeHeap;
+    uint32_t largestFreeBlock;
+    // Percentage of free heap not usable by the largest allocation
+    float fragmentation;
+    // Stack high-water marks, in bytes
+    uint32_t stackHighWaterMarks[N_MONITORED_TASKS];
+    // Min-ever values, not cleared by resetStats()
+    uint32_t minFreeHeap;
+    uint32_t minLargestFreeBlock;
+    float maxFragmentation;
+    uint32_t minStackHighWaterMarks[N_MONITORED_TASKS];
+};
+
+// Boot phases, in the order they complete. Serial commands are served from BOOT_READY,
+// the filesystem and portal phases finish later on a background task
+enum BootPhase {
+    BOOT_SERIAL,
+    BOOT_BUTTON,
+    BOOT_CURVE,
+    BOOT_STORAGE,
+    BOOT_READY,
+    BOOT_FILESYSTEM,
+    BOOT_WIFI,
+    BOOT_SERVER,
+    BOOT_PHASES
+};
+
+struct BootStats {
+    // Completion time of each phase in us since boot, 0 if not reached
+    unsigned long phases[BOOT_PHASES];
+    // Time the first command was dispatched in us since boot
+    unsigned long firstCommand;
+    // Phase that could not complete, BOOT_PHASES if none failed
+    BootPhase failedPhase;
+};
+
+// Public key decompression cost, not cleared by resetStats() as it only happens once per key per boot
+struct KeyStats {
+    unsigned long decompressions;
+    unsigned long lastDecompressTime;
+    unsigned long maxDecompressTime;
 };
 
 extern Stats stats;
+extern Stats lastStats;
+extern BootStats bootStats;
+extern KeyStats keyStats;
 extern ComputedStats computedStats;
+extern MemoryStats memoryStats;
+
+void sampleMemory();
+// Static metadata (task names, boot phases) is only included when full is set,
+// periodic pushes carry the changing numbers in the same order
+void serializeMemoryStats(JsonObject root, bool full = true);
+void serializeStats(JsonObject root, bool full = true);
 
-TaskResult printStats(unsigned long now);
+TaskResult collectStats(unsigned long now);
+void resetStats();
+void recordDnsQuery(unsigned long ellapsed);
+void recordKeyDecompression(unsigned long ellapsed);
+void markBootPhase(BootPhase phase);
+void markBootFailure(BootPhase phase);
+void markCommand();
 
 void setError(ErrorCode code);
 char* getReason(ErrorCode code);
\ No newline at end of file
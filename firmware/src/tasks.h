@@ -0,0 +1,36 @@
+#pragma once
+
+#include "board.h"
+#include "scheduler.h"
+#include "serial_commands.h"
+#include "captive_portal.h"
+#include "stats.h"
+
+struct TaskDef {
+    TaskId id;
+    task run;
+    // Period in ms
+    unsigned long period;
+    const char *name;
+    // Whether the task runs by default, setup mode enables the rest
+    bool enabled;
+};
+
+// Single source of truth for the scheduler: dispatch, periods, names and enablement
+inline constexpr TaskDef TASKS[] = {
+    { READ_COMMANDS, readCommands, 100, "readCommands", true },
+    { DO_SERVER_WORK, doServerWork, 50, "doServerWork", false },
+    { COLLECT_STATS, collectStats, 2000, "collectStats", true },
+};
+
+constexpr bool tasksMatchIds() {
+    for(int i = 0; i < N_TASKS; i++) {
+        if(TASKS[i].id != i) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static_assert(sizeof(TASKS) / sizeof(TASKS[0]) == N_TASKS, "TASKS must define every TaskId");
+static_assert(tasksMatchIds(), "TASKS must be ordered by TaskId");
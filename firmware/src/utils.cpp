@@ -3,4 +3,28 @@
 void writeDebug(const char *message) {
     Serial.print(F("[DEBUG] "));
     Serial.println(message);
+}
+
+int hexValue(char c) {
+    if(c >= '0' && c <= '9') return c - '0';
+    if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Returns the number of decoded bytes, or 0 on malformed or oversized input
+size_t hexToBytes(const char *hex, uint8_t *bytes, size_t maxLength) {
+    size_t length = strlen(hex);
+    if(length % 2 != 0 || length / 2 > maxLength) {
+        return 0;
+    }
+    for(size_t i = 0; i < length / 2; i++) {
+        int high = hexValue(hex[2 * i]);
+        int low = hexValue(hex[2 * i + 1]);
+        if(high < 0 || low < 0) {
+            return 0;
+        }
+        bytes[i] = (high << 4) | low;
+    }
+    return length / 2;
 }
\ No newline at end of file
@@ -1,3 +1,4 @@
 #include <Arduino.h>
 
-void writeDebug(const char *message);
\ No newline at end of file
+void writeDebug(const char *message);
+size_t hexToBytes(const char *hex, uint8_t *bytes, size_t maxLength);
\ No newline at end of file
@@ -14,6 +14,14 @@ export enum CommandType {
   GET_SENDER_REQUEST,
   GET_SENDER_RESPONSE,
   ERROR,
+  GET_MEMORY_STATS_REQUEST,
+  GET_MEMORY_STATS_RESPONSE,
+  GET_STATS_REQUEST,
+  GET_STATS_RESPONSE,
+  SIGNATURE_STREAM_START,
+  SIGNATURE_STREAM_CHUNK,
+  SIGNATURE_STREAM_END,
+  SIGNATURE_STREAM_ACK,
 }
 
 type Command = {